@@ -11,8 +11,13 @@
 //THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "stdafx.h"
+#include "SolverWorkspace.h"
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <stdexcept>
 #include <Eigen/Dense>
 
 
@@ -27,6 +32,9 @@
 //NOTES: 
 //User will assign inputs based on use case
 //Write a class that allows the user to do this
+//f(x) and f'(x) read and write views of buffers that only grow, so
+//repeated solves sharing a workspace do not allocate even when the
+//number of observations changes
 
 template <class Bs>
 class newton_raphson {
@@ -35,65 +43,123 @@ class newton_raphson {
 		//typedef
 		typedef Eigen::Matrix<Bs, Eigen::Dynamic, 1> VectorXp;
 		typedef Eigen::Matrix<Bs, Eigen::Dynamic, Eigen::Dynamic> MatrixXp;
+		typedef Eigen::Ref<const VectorXp> ConstRefVectorXp;
+		typedef Eigen::Ref<VectorXp> RefVectorXp;
+		typedef Eigen::Ref<MatrixXp> RefMatrixXp;
+		//f(x, xs, actual_rho, t) -> f and f'(x, xs, t) -> H
+		typedef std::function <void(const ConstRefVectorXp&, const ConstRefVectorXp&, const ConstRefVectorXp&, const ConstRefVectorXp&, RefVectorXp)> FunctionXp;
+		typedef std::function <void(const ConstRefVectorXp&, const ConstRefVectorXp&, const ConstRefVectorXp&, RefMatrixXp)> DerivXp;
+		//observation weighting
+		enum estimator { least_squares, huber, tukey };
 
 		//set functions
-		void set_function(std::function <VectorXp(VectorXp, VectorXp, VectorXp, VectorXp)> *fun);
-		std::function <VectorXp(VectorXp, VectorXp, VectorXp, VectorXp)> fcn;
-		void set_deriv(std::function <MatrixXp(VectorXp, VectorXp, VectorXp)> *der);
-		std::function <MatrixXp(VectorXp, VectorXp, VectorXp)> drv;
+		void set_function(FunctionXp *fun);
+		FunctionXp fcn;
+		void set_deriv(DerivXp *der);
+		DerivXp drv;
 		
 		//declare initial state
-		void set_x0(VectorXp state_vector);
-		void set_t(VectorXp time);
-		void set_actual_range(VectorXp actual_range);
+		void set_x0(const VectorXp& state_vector);
+		void set_t(const VectorXp& time);
+		void set_actual_range(const VectorXp& actual_range);
 		//declare observer's state
-		void set_ground_station(VectorXp ground_station);
+		void set_ground_station(const VectorXp& ground_station);
 
 		//declare max error allowed
 		void set_max_error(Bs max_error_allowed);
 		//declare number of steps to use
 		void set_num_steps(int num_steps);
+		//declare observation sigmas (unit if not set), one per
+		//observation and all > 0 or iterate() throws
+		void set_sigma(const VectorXp& observation_sigma);
+		//declare robust estimator, tuning constant in units of the robust
+		//scale (1.4826*MAD of the residuals) and reweighting passes per
+		//iteration; with sigmas set the scale is never below 1 sigma,
+		//without them it is the MAD alone in measurement units
+		void set_robust(estimator robust_estimator, Bs tuning_constant, int num_reweights = 1);
+		//declare caller-owned scratch memory (internal if not set)
+		void set_workspace(solver_workspace<Bs> *workspace);
 
 		//f(x)
-		VectorXp func(VectorXp x, VectorXp xs, VectorXp actual_rho, VectorXp t);
+		void func(const ConstRefVectorXp& x, const ConstRefVectorXp& xs, const ConstRefVectorXp& actual_rho, const ConstRefVectorXp& t, RefVectorXp f);
 		//f'(x)
-		MatrixXp deriv(VectorXp x, VectorXp xs, VectorXp t);
+		void deriv(const ConstRefVectorXp& x, const ConstRefVectorXp& xs, const ConstRefVectorXp& t, RefMatrixXp H);
 
 		//access
+		//iteration history is read from the workspace, so it is only
+		//valid until another iterate() uses the same workspace; copy
+		//it out before sharing the workspace with another solver
 		MatrixXp get_res();
 		MatrixXp get_x();
+		//final state, owned by the solver
 		VectorXp get_x0();
 		VectorXp get_rms();
+		//statistics from the final iteration's normal equations,
+		//evaluated on first request and valid until the workspace
+		//is reused
+		MatrixXp get_covariance();
+		VectorXp get_postfit_res();
+		Bs get_weighted_rms();
+		VectorXp get_leverage();
+		//robust weight of each observation, 0 if rejected
+		VectorXp get_weights();
+		//true if H'WH was singular and the last step was not taken
+		bool get_rank_deficient();
 
-		//iterate
-		void iterate();
+		//iterate, false if the normal equations were rank deficient
+		bool iterate();
 
 	private:
 		//initial and final state vector
 		VectorXp x;
-		//time
+		//time, actual range and observation sigmas, held in buffers
+		//that only grow; the leading n_t, n_rho and n_sigma are in use
 		VectorXp t;
-		//actual range
 		VectorXp actual_rho;
+		VectorXp sigma;
+		int n_t = 0;
+		int n_rho = 0;
+		int n_sigma = 0;
 		//ground station state vector
 		VectorXp xs;
 		//max error allowed
 		Bs err;
-		//next iteration
-		MatrixXp x_new;
-		//residuals
-		MatrixXp res;
 		//number of steps for calculating
 		int steps;
-		//rms
-		VectorXp rms;
-		//store all state vector iterations, residuals, and rms
-		MatrixXp store_xnew;
-		MatrixXp store_res;
-		VectorXp store_rms;
+		//number of stored iterations
+		int count = 0;
+		//robust estimator
+		estimator robust = least_squares;
+		Bs tuning;
+		int reweights = 0;
 
+		//iteration history, whitened jacobian, observation residuals,
+		//factored normal matrix (H'WH) and robust weights
+		solver_workspace<Bs> *ws = nullptr;
+		solver_workspace<Bs> own_workspace;
+		solver_workspace<Bs>& work();
 
-		MatrixXp state_transition_matrix;
+		//lazily evaluated statistics
+		MatrixXp covariance;
+		VectorXp postfit;
+		VectorXp leverage;
+		Bs weighted_rms;
+		bool have_covariance = false;
+		bool have_postfit = false;
+		bool have_weighted_rms = false;
+		bool have_leverage = false;
+		bool rank_deficient = false;
+
+		//copy values into the front of a grow-only buffer
+		static void store(VectorXp& buffer, int& used, const VectorXp& values);
+		//factor the normal equations at x and solve for the state correction
+		void correction();
+		//false if the factor failed or H'WH scaled to a unit diagonal
+		//has a pivot below n*epsilon, i.e. is numerically singular
+		bool full_rank();
+		//update robust weights from the linearized fit, return false
+		//once no weight changes
+		bool reweight();
 
 };
 
@@ -106,15 +172,15 @@ using MatrixXp = typename newton_raphson<Bs>::MatrixXp;
 
 //set
 template <class Bs>
-void newton_raphson<Bs>::set_function(std::function <VectorXp(VectorXp, VectorXp, VectorXp, VectorXp)> *fun) {
+void newton_raphson<Bs>::set_function(FunctionXp *fun) {
 	fcn = *fun;
 }
 template <class Bs>
-void newton_raphson<Bs>::set_deriv(std::function <MatrixXp(VectorXp, VectorXp, VectorXp)> *der) {
+void newton_raphson<Bs>::set_deriv(DerivXp *der) {
 	drv = *der;
 }
 template <class Bs>
-void newton_raphson<Bs>::set_x0(VectorXp state_vector) {
+void newton_raphson<Bs>::set_x0(const VectorXp& state_vector) {
 	x = state_vector;
 }
 template <class Bs>
@@ -126,27 +192,53 @@ void newton_raphson<Bs>::set_num_steps(int num_steps) {
 	steps = num_steps;
 }
 template<class Bs>
-void newton_raphson<Bs>::set_t(VectorXp time) {
-	t = time;
+void newton_raphson<Bs>::set_t(const VectorXp& time) {
+	store(t, n_t, time);
 }
 template<class Bs>
-void newton_raphson<Bs>::set_actual_range(VectorXp actual_range) {
-	actual_rho = actual_range;
+void newton_raphson<Bs>::set_actual_range(const VectorXp& actual_range) {
+	store(actual_rho, n_rho, actual_range);
 }
 template<class Bs>
-void newton_raphson<Bs>::set_ground_station(VectorXp ground_station) {
+void newton_raphson<Bs>::set_ground_station(const VectorXp& ground_station) {
 	xs = ground_station;
 }
+template<class Bs>
+void newton_raphson<Bs>::set_sigma(const VectorXp& observation_sigma) {
+	store(sigma, n_sigma, observation_sigma);
+}
+template<class Bs>
+void newton_raphson<Bs>::set_robust(estimator robust_estimator, Bs tuning_constant, int num_reweights) {
+	robust = robust_estimator;
+	tuning = tuning_constant;
+	reweights = num_reweights;
+}
+template<class Bs>
+void newton_raphson<Bs>::set_workspace(solver_workspace<Bs> *workspace) {
+	ws = workspace;
+}
+template<class Bs>
+solver_workspace<Bs>& newton_raphson<Bs>::work() {
+	return (ws != nullptr) ? *ws : own_workspace;
+}
+template<class Bs>
+void newton_raphson<Bs>::store(VectorXp& buffer, int& used, const VectorXp& values) {
+	if (values.rows() > buffer.rows()) {
+		buffer.resize(values.rows());
+	}
+	used = int(values.rows());
+	buffer.head(used) = values;
+}
 
 
 //access
 template <class Bs>
 Eigen::Matrix<Bs, Eigen::Dynamic, Eigen::Dynamic> newton_raphson<Bs>::get_res() {
-	return res;
+	return work().res.leftCols(count);
 }
 template <class Bs>
 Eigen::Matrix<Bs, Eigen::Dynamic, Eigen::Dynamic> newton_raphson<Bs>::get_x() {
-	return newton_raphson::x_new;
+	return work().x_new.leftCols(count);
 }
 template <class Bs>
 Eigen::Matrix<Bs, Eigen::Dynamic, 1> newton_raphson<Bs>::get_x0() {
@@ -154,59 +246,284 @@ Eigen::Matrix<Bs, Eigen::Dynamic, 1> newton_raphson<Bs>::get_x0() {
 }
 template <class Bs>
 Eigen::Matrix<Bs, Eigen::Dynamic, 1> newton_raphson<Bs>::get_rms() {
-	return rms;
+	return work().rms.head(count);
 }
 //f(x)
 template <class Bs>
-Eigen::Matrix<Bs, Eigen::Dynamic, 1> newton_raphson<Bs>::func(VectorXp x, VectorXp xs, VectorXp actual_rho, VectorXp t) {
-	return fcn(x, xs, actual_rho, t);
+void newton_raphson<Bs>::func(const ConstRefVectorXp& x, const ConstRefVectorXp& xs, const ConstRefVectorXp& actual_rho, const ConstRefVectorXp& t, RefVectorXp f) {
+	fcn(x, xs, actual_rho, t, f);
 }
 //f'(x)
 template<class Bs>
-Eigen::Matrix<Bs, Eigen::Dynamic, Eigen::Dynamic> newton_raphson<Bs>::deriv(VectorXp x, VectorXp xs, VectorXp t) {
-	return drv(x, xs, t);
+void newton_raphson<Bs>::deriv(const ConstRefVectorXp& x, const ConstRefVectorXp& xs, const ConstRefVectorXp& t, RefMatrixXp H) {
+	drv(x, xs, t, H);
+}
+
+//statistics
+template <class Bs>
+Eigen::Matrix<Bs, Eigen::Dynamic, Eigen::Dynamic> newton_raphson<Bs>::get_covariance() {
+	//P = (H'WH)^-1 from the stored factorization, NaN if singular
+	if (!have_covariance) {
+		solver_workspace<Bs>& w = work();
+		if (rank_deficient) {
+			covariance = MatrixXp::Constant(w.state_size(), w.state_size(), std::numeric_limits<Bs>::quiet_NaN());
+		}
+		else {
+			covariance = w.normal_matrix.solve(MatrixXp::Identity(w.state_size(), w.state_size()));
+		}
+		have_covariance = true;
+	}
+	return covariance;
+}
+template <class Bs>
+Eigen::Matrix<Bs, Eigen::Dynamic, 1> newton_raphson<Bs>::get_postfit_res() {
+	//linearized about the final correction: y - h(x) - H*dx,
+	//back in measurement units
+	if (!have_postfit) {
+		solver_workspace<Bs>& w = work();
+		int m = w.obs_size();
+		postfit = w.prefit.head(m) - w.jacobian.topRows(m) * w.step;
+		if (n_sigma > 0) {
+			postfit.array() *= sigma.head(m).array();
+		}
+		have_postfit = true;
+	}
+	return postfit;
+}
+template <class Bs>
+Bs newton_raphson<Bs>::get_weighted_rms() {
+	//sqrt(r'Wr / sum(W)) of the whitened post-fit residuals, so
+	//observations rejected by the robust weights do not count
+	if (!have_weighted_rms) {
+		solver_workspace<Bs>& w = work();
+		int m = w.obs_size();
+		VectorXp r = w.prefit.head(m) - w.jacobian.topRows(m) * w.step;
+		weighted_rms = std::sqrt(w.weight.head(m).dot(r.cwiseAbs2()) / w.weight.head(m).sum());
+		have_weighted_rms = true;
+	}
+	return weighted_rms;
+}
+template <class Bs>
+Eigen::Matrix<Bs, Eigen::Dynamic, 1> newton_raphson<Bs>::get_leverage() {
+	//diagonal of H*P*H'W
+	if (!have_leverage) {
+		solver_workspace<Bs>& w = work();
+		int m = w.obs_size();
+		get_covariance();
+		leverage = w.weight.head(m).cwiseProduct((w.jacobian.topRows(m) * covariance).cwiseProduct(w.jacobian.topRows(m)).rowwise().sum());
+		have_leverage = true;
+	}
+	return leverage;
+}
+template <class Bs>
+Eigen::Matrix<Bs, Eigen::Dynamic, 1> newton_raphson<Bs>::get_weights() {
+	return work().weight.head(work().obs_size());
+}
+template <class Bs>
+bool newton_raphson<Bs>::get_rank_deficient() {
+	return rank_deficient;
 }
 
 //////////////////////////////////////////////////////////////
 ///Calculations
 
 template <class Bs>
-void newton_raphson<Bs>::iterate() 
+void newton_raphson<Bs>::correction()
+{
+	solver_workspace<Bs>& w = work();
+	int m = w.obs_size();
+	auto H = w.jacobian.topRows(m);
+	auto f = w.prefit.head(m);
+	//evaluate f(x) and f'(x) once per iteration
+	deriv(x, xs, t.head(m), H);
+	func(x, xs, actual_rho.head(m), t.head(m), f);
+	//whiten rows by the observation sigmas in place
+	if (n_sigma > 0) {
+		H.array().colwise() /= sigma.head(m).array();
+		f.array() /= sigma.head(m).array();
+	}
+	//solve (H'WH)dx = H'Wf without forming the inverse,
+	//robust weights carry over from the previous iteration
+	if (robust == least_squares) {
+		w.normal.noalias() = H.transpose() * H;
+		w.rhs.noalias() = H.transpose() * f;
+	}
+	else {
+		auto WH = w.weighted_jacobian.topRows(m);
+		WH = w.weight.head(m).asDiagonal() * H;
+		w.normal.noalias() = H.transpose() * WH;
+		w.rhs.noalias() = WH.transpose() * f;
+	}
+	w.normal_matrix.compute(w.normal);
+	w.step = w.normal_matrix.solve(w.rhs);
+	//reweight against the same linearization
+	if (robust != least_squares) {
+		for (int k = 0; k < reweights; k++) {
+			if (!reweight()) {
+				break;
+			}
+		}
+	}
+	rank_deficient = !full_rank();
+	have_covariance = false;
+	have_postfit = false;
+	have_weighted_rms = false;
+	have_leverage = false;
+}
+
+template <class Bs>
+bool newton_raphson<Bs>::full_rank()
+{
+	solver_workspace<Bs>& w = work();
+	if (w.normal_matrix.info() != Eigen::Success) {
+		return false;
+	}
+	//reweighting only updates the factor, rebuild H'WH
+	int m = w.obs_size();
+	if (robust != least_squares) {
+		w.normal.noalias() = w.jacobian.topRows(m).transpose() * w.weighted_jacobian.topRows(m);
+	}
+	//columns of H differ in scale by t^2, so test D^-1/2 (H'WH) D^-1/2
+	//with D = diag(H'WH) rather than the raw pivots
+	VectorXp& d = w.equilibration;
+	d = w.normal.diagonal();
+	if (!d.allFinite() || !(d.array() > Bs(0)).all()) {
+		return false;
+	}
+	d = d.cwiseSqrt().cwiseInverse();
+	w.scaled_normal = d.asDiagonal() * w.normal * d.asDiagonal();
+	w.scaled_matrix.compute(w.scaled_normal);
+	if (w.scaled_matrix.info() != Eigen::Success) {
+		return false;
+	}
+	return w.scaled_matrix.vectorD().minCoeff() > Bs(x.rows()) * Eigen::NumTraits<Bs>::epsilon();
+}
+
+template <class Bs>
+bool newton_raphson<Bs>::reweight()
+{
+	solver_workspace<Bs>& w = work();
+	int m = w.obs_size();
+	auto H = w.jacobian.topRows(m);
+	auto f = w.prefit.head(m);
+	auto u = w.fit_res.head(m);
+	auto v = w.abs_res.head(m);
+	//residuals of the current linearized fit, in sigmas
+	u = f;
+	u.noalias() -= H * w.step;
+	//robust scale (MAD), never tighter than the given sigmas; without
+	//sigmas the residuals are in measurement units and there is no floor
+	v = u.cwiseAbs();
+	int mid = m / 2;
+	std::nth_element(v.data(), v.data() + mid, v.data() + m);
+	Bs scale = Bs(1.4826) * v(mid);
+	if (n_sigma > 0) {
+		scale = std::max(Bs(1), scale);
+	}
+	//a zero MAD (most residuals exact) gives no scale to weight against
+	if (!(scale > Bs(0)) || !std::isfinite(scale)) {
+		return false;
+	}
+	//new weights, reusing abs_res
+	int kept = 0;
+	for (int i = 0; i < m; i++)
+	{
+		Bs a = std::abs(u(i)) / scale;
+		if (robust == huber) {
+			v(i) = (a <= tuning) ? Bs(1) : tuning / a;
+		}
+		else {
+			//tukey biweight rejects beyond the tuning constant
+			v(i) = (a < tuning) ? std::pow(Bs(1) - std::pow(a / tuning, 2), 2) : Bs(0);
+		}
+		if (v(i) > Bs(0)) {
+			kept++;
+		}
+	}
+	//keep the current weights rather than reject down to fewer
+	//observations than states
+	if (kept < int(x.rows())) {
+		return false;
+	}
+	bool changed = false;
+	for (int i = 0; i < m; i++)
+	{
+		Bs wi = v(i);
+		//only changed rows touch the factorization
+		Bs dw = wi - w.weight(i);
+		if (std::abs(dw) > Eigen::NumTraits<Bs>::dummy_precision()) {
+			w.normal_matrix.rankUpdate(H.row(i).transpose(), dw);
+			w.weight(i) = wi;
+			changed = true;
+		}
+	}
+	if (changed) {
+		auto WH = w.weighted_jacobian.topRows(m);
+		WH = w.weight.head(m).asDiagonal() * H;
+		w.rhs.noalias() = WH.transpose() * f;
+		w.step = w.normal_matrix.solve(w.rhs);
+	}
+	return changed;
+}
+
+template <class Bs>
+bool newton_raphson<Bs>::iterate() 
 {
+	//observation sigmas must match the observations and be positive
+	if (n_rho != n_t) {
+		throw std::invalid_argument("newton_raphson: need one range per time");
+	}
+	if (n_sigma > 0 && (n_sigma != n_t || !(sigma.head(n_sigma).array() > Bs(0)).all())) {
+		throw std::invalid_argument("newton_raphson: need one sigma > 0 per observation");
+	}
+	//size scratch memory for this problem and start from unit weights
+	solver_workspace<Bs>& w = work();
+	w.reserve(int(x.rows()), n_t, steps);
+	w.reset();
 	//determine if error conditions have been met
 	int i = 0;
-	x_new.conservativeResize(x.rows(), i+1);
-	res.conservativeResize(x.rows(), i+1);
-	rms.conservativeResize(i+1);
+	count = i+1;
 	/*RUN TO GET INITIAL RMS VALUE*/
 	//calculate next iteration
-	state_transition_matrix = ((deriv(x, xs, t).transpose() * deriv(x, xs, t)).inverse()) * deriv(x, xs, t).transpose();
-	x_new.col(i) = x - (state_transition_matrix * func(x, xs, actual_rho, t));
+	correction();
+	if (rank_deficient) {
+		//no usable step, report the initial state
+		w.x_new.col(i) = x;
+		w.res.col(i).setZero();
+		w.rms(i) = std::numeric_limits<Bs>::quiet_NaN();
+		return false;
+	}
+	w.x_new.col(i) = x - w.step;
 	//calculate residuals
-	res.col(i) = x_new.col(i) - x;
+	w.res.col(i) = w.x_new.col(i) - x;
 	//calculate rms
-	rms(i) = res.col(i).norm();
+	w.rms(i) = w.res.col(i).norm();
 
-	while (rms(i) > err) {
+	while (w.rms(i) > err) {
 		//calculate next iteration
-		state_transition_matrix = ((deriv(x, xs, t).transpose() * deriv(x, xs, t)).inverse()) * deriv(x, xs, t).transpose();
-		res.col(i) = (state_transition_matrix * func(x, xs, actual_rho, t));
+		correction();
+		if (rank_deficient) {
+			break;
+		}
+		w.res.col(i) = w.step;
 		//calculate residuals
-		x_new.col(i) = x + res.col(i);
+		w.x_new.col(i) = x + w.res.col(i);
 		//calculate rms
-		rms(i) = res.col(i).norm();
+		w.rms(i) = w.res.col(i).norm();
 
 		//set x to xnew
-		x = x_new.col(i);
+		x = w.x_new.col(i);
 		i = i + 1;
-		if (i == int(steps)) {
+		count = i;
+		if (i >= int(steps)) {
 			break;
 		}
-		x_new.conservativeResize(x.rows(), i+1);
-		res.conservativeResize(x.rows(), i+1);
-		rms.conservativeResize(i+1);
-		rms(i) = rms(i - 1);
+		count = i+1;
+		w.x_new.col(i) = w.x_new.col(i - 1);
+		w.res.col(i) = w.res.col(i - 1);
+		w.rms(i) = w.rms(i - 1);
 	}
+	return !rank_deficient;
 }
 
 
@@ -0,0 +1,64 @@
+/// RangeModel.h : Planar ballistic object ranged from a ground station
+///inputs: x0-[x y x_dot y_dot g] at t=0, xs-station [x y x_dot y_dot], t-times
+///outputs: range, range residuals f(x) and their partials f'(x)
+//Copyright <2018> <SIMPSONAEROSPACE>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "stdafx.h"
+#include <cmath>
+#include <Eigen/Dense>
+
+
+#ifndef RANGEMODEL_H
+#define RANGEMODEL_H
+
+//kinematics
+typedef Eigen::Matrix<double, 5, 1> Vector5d;
+inline Vector5d state_vector_at(/*given*/ const Eigen::Ref<const Eigen::VectorXd>& x0, double t) {
+	//x0(0)/*x*/
+	//x0(1)/*y*/
+	//x0(2)/*x_dot*/
+	//x0(3)/*y_dot*/
+	//x0(4)/*g*/
+	Vector5d state_vector;
+	state_vector(0) /*x*/ = x0(0) + x0(2) * t;
+	state_vector(1) /*y*/ = x0(1) + x0(3) * t - x0(4) * 0.5*pow(t, 2);
+	state_vector(2) /*x_dot*/ = x0(2);
+	state_vector(3) /*y_dot*/ = x0(3) - x0(4) * t;
+	state_vector(4) /*g*/ = x0(4);
+	return state_vector;
+}
+//range
+inline double range_eqn(const Eigen::Ref<const Eigen::VectorXd>& x0, const Eigen::Ref<const Eigen::VectorXd>& xs, double t) {
+	Vector5d x = state_vector_at(x0, t);
+	double rho = sqrt(pow((x(0) - xs(0)), 2) + pow((x(1) - xs(1)), 2));
+	return rho;
+}
+//f(x)
+inline void x2rho(const Eigen::Ref<const Eigen::VectorXd>& x0, const Eigen::Ref<const Eigen::VectorXd>& xs, const Eigen::Ref<const Eigen::VectorXd>& actual_rho, const Eigen::Ref<const Eigen::VectorXd>& t, Eigen::Ref<Eigen::VectorXd> rho_res) {
+	for (int i = 0; i < t.rows(); i++)
+	{
+		rho_res(i) = actual_rho(i) - range_eqn(x0, xs, t(i));
+	}
+}
+//f'(x)
+inline void deriv_of_x2rho(const Eigen::Ref<const Eigen::VectorXd>& x0, const Eigen::Ref<const Eigen::VectorXd>& xs, const Eigen::Ref<const Eigen::VectorXd>& t, Eigen::Ref<Eigen::MatrixXd> x_of_t) {
+	for (int j = 0; j < t.rows(); j++)
+	{
+		double rho = range_eqn(x0, xs, t(j));
+		x_of_t.row(j) = state_vector_at(x0, t(j));
+
+		x_of_t(j, 0) = (x_of_t(j, 0) - xs(0)) / rho;
+		x_of_t(j, 1) = (x_of_t(j, 1) - xs(1)) / rho;
+		x_of_t(j, 2) = t(j)*x_of_t(j,0);
+		x_of_t(j, 3) = t(j)*x_of_t(j,1);
+		x_of_t(j, 4) = -0.5*pow(t(j),2) * x_of_t(j,1);
+	}
+}
+
+#endif /*RANGEMODEL_H*/
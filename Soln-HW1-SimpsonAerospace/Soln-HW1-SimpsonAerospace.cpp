@@ -12,9 +12,16 @@
 
 #include "stdafx.h"
 #include "NewtonRaphson.h"
+#include "SolveService.h"
+#include "TrackingGenerator.h"
+#include "RangeModel.h"
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <string>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
 #include <Eigen/Dense>
 
 
@@ -24,65 +31,63 @@ ofstream output_file;
 std::string state_vector_file = "xnew.csv";
 std::string residuals_file = "res.csv";
 
-//kinematics
-Eigen::VectorXd state_vector_at(/*given*/ Eigen::VectorXd x0, double t) {
-	//x0(0)/*x*/
-	//x0(1)/*y*/
-	//x0(2)/*x_dot*/
-	//x0(3)/*y_dot*/
-	//x0(4)/*g*/
-	Eigen::VectorXd state_vector(5);
-	state_vector(0) /*x*/ = x0(0) + x0(2) * t;
-	state_vector(1) /*y*/ = x0(1) + x0(3) * t - x0(4) * 0.5*pow(t, 2);
-	state_vector(2) /*x_dot*/ = x0(2);
-	state_vector(3) /*y_dot*/ = x0(3) - x0(4) * t;
-	state_vector(4) /*g*/ = x0(4);
-	return state_vector;
-}
-//range
-double range_eqn(Eigen::VectorXd x0, Eigen::VectorXd xs, double t) {
-	Eigen::VectorXd x = state_vector_at(x0, t);
-	double rho = sqrt(pow((x(0) - xs(0)), 2) + pow((x(1) - xs(1)), 2));
-	return rho;
-}
-//f(x)
-Eigen::VectorXd x2rho(Eigen::VectorXd x0, Eigen::VectorXd xs, Eigen::VectorXd actual_rho, Eigen::VectorXd t) {
 
-	Eigen::VectorXd rho(5);
-	for (int i = 0; i < rho.rows(); i++)
-	{
-		rho(i) = range_eqn(x0, xs, t(i));		
+int main(int argc, char* argv[])
+{
+	//run as a fit service on stdin/stdout:
+	// Soln-HW1-SimpsonAerospace --serve [threads] [batch] [queue] [stats_seconds]
+	if (argc > 1 && std::string(argv[1]) == "--serve") {
+		int threads = (argc > 2) ? atoi(argv[2]) : int(std::thread::hardware_concurrency());
+		int batch = (argc > 3) ? atoi(argv[3]) : 16;
+		int queue = (argc > 4) ? atoi(argv[4]) : 1024;
+		double stats_seconds = (argc > 5) ? atof(argv[5]) : 0.0;
+		newton_raphson<double>::FunctionXp fun = bind(&x2rho, placeholders::_1, placeholders::_2, placeholders::_3, placeholders::_4, placeholders::_5);
+		newton_raphson<double>::DerivXp der = bind(&deriv_of_x2rho, placeholders::_1, placeholders::_2, placeholders::_3, placeholders::_4);
+		solve_service service(fun, der, 5, 4, cout, threads, batch, queue, stats_seconds);
+		service.serve(cin);
+		return 0;
 	}
+	//write synthetic fit jobs to stdout:
+	// Soln-HW1-SimpsonAerospace --generate objects stations samples [noise] [gap] [outlier] [threads] [seed]
+	if (argc > 4 && std::string(argv[1]) == "--generate") {
+		tracking_generator::config cfg;
+		cfg.objects = atoi(argv[2]);
+		cfg.stations = atoi(argv[3]);
+		cfg.samples = atoi(argv[4]);
+		//every arc is one fit line, so it must fit in one service request
+		if (cfg.samples < 1 || cfg.samples > solve_service::max_obs) {
+			cerr << "--generate: samples must be in 1.." << solve_service::max_obs << ", the most observations --serve accepts per fit" << endl;
+			return 1;
+		}
+		cfg.noise = (argc > 5) ? atof(argv[5]) : 0.0;
+		cfg.gap_probability = (argc > 6) ? atof(argv[6]) : 0.0;
+		cfg.gap_length = 5;
+		cfg.outlier_probability = (argc > 7) ? atof(argv[7]) : 0.0;
+		cfg.outlier_sigma = 100.0 * std::max(cfg.noise, 1.0e-3);
+		cfg.threads = (argc > 8) ? atoi(argv[8]) : int(std::thread::hardware_concurrency());
+		cfg.seed = (argc > 9) ? strtoull(argv[9], nullptr, 10) : 1;
+		//objects around the homework solution, stations around the GS
+		cfg.x0_mean.resize(5);
+		cfg.x0_mean << 1.0, 8.0, 2.0, 1.0, 0.5;
+		cfg.x0_spread.resize(5);
+		cfg.x0_spread << 0.5, 0.5, 0.2, 0.2, 0.05;
+		cfg.guess_sigma.resize(5);
+		cfg.guess_sigma << 0.5, 1.0, 0.2, 0.5, 0.2;
+		cfg.xs_mean.resize(4);
+		cfg.xs_mean << 1.0, 1.0, 0.0, 0.0;
+		cfg.xs_spread.resize(4);
+		cfg.xs_spread << 5.0, 0.5, 0.0, 0.0;
 
-	Eigen::VectorXd rho_res = actual_rho - rho;
-	return rho_res;
-}
-//f'(x)
-Eigen::MatrixXd deriv_of_x2rho(Eigen::VectorXd x0, Eigen::VectorXd xs, Eigen::VectorXd t) {
-	Eigen::MatrixXd x_of_t(5, 5);
-	Eigen::VectorXd rho(5);
-	for (int i = 0; i < rho.rows(); i++)
-	{
-		rho(i) = range_eqn(x0, xs, t(i));
-		x_of_t.row(i) = state_vector_at(x0, t(i));
+		ios::sync_with_stdio(false);
+		tracking_generator generator(&range_eqn, cfg);
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		long long samples = generator.generate(cout);
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		cerr << "samples " << samples << " dropped_arcs " << generator.get_dropped()
+			<< " seconds " << seconds << " samples_per_min " << (seconds > 0.0 ? 60.0 * samples / seconds : 0.0) << endl;
+		return 0;
 	}
 
-
-	for (int j = 0; j < x_of_t.cols(); j++)
-	{
-		x_of_t(j, 0) = (x_of_t(j, 0) - xs(0)) / rho(j);
-		x_of_t(j, 1) = (x_of_t(j, 1) - xs(1)) / rho(j);
-		x_of_t(j, 2) = t(j)*x_of_t(j,0);
-		x_of_t(j, 3) = t(j)*x_of_t(j,1);
-		x_of_t(j, 4) = -0.5*pow(t(j),2) * x_of_t(j,1);
-	}
-
-	return x_of_t;
-}
-
-
-int main()
-{
 	//initial state
 	Eigen::VectorXd x0(5);
 	x0(0)/*x*/     = 1.5;
@@ -112,10 +117,13 @@ int main()
 		          10.630145813;
 	
 	
-	function <Eigen::VectorXd(Eigen::VectorXd, Eigen::VectorXd, Eigen::VectorXd, Eigen::VectorXd)> primary_function = bind(&x2rho, placeholders::_1, placeholders::_2, placeholders::_3, placeholders::_4);
-	function <Eigen::MatrixXd(Eigen::VectorXd, Eigen::VectorXd, Eigen::VectorXd)> derivative_function = bind(&deriv_of_x2rho, placeholders::_1, placeholders::_2, placeholders::_3);
+	newton_raphson<double>::FunctionXp primary_function = bind(&x2rho, placeholders::_1, placeholders::_2, placeholders::_3, placeholders::_4, placeholders::_5);
+	newton_raphson<double>::DerivXp derivative_function = bind(&deriv_of_x2rho, placeholders::_1, placeholders::_2, placeholders::_3, placeholders::_4);
+	//scratch memory, reused across solves of the same size
+	solver_workspace<double> workspace(5, 5, 1e+4);
 	//initialize problem
 	newton_raphson<double> od;
+	od.set_workspace(&workspace);
 	od.set_function(&primary_function);
 	od.set_deriv(&derivative_function);
 	od.set_max_error(1.0e-6);
@@ -131,12 +139,21 @@ int main()
 	Eigen::MatrixXd all_x = od.get_x();
 	Eigen::VectorXd x0_final = od.get_x0();
 	Eigen::VectorXd all_rms = od.get_rms();
+	Eigen::MatrixXd covariance = od.get_covariance();
+	Eigen::VectorXd postfit_res = od.get_postfit_res();
 	
 	////Output
 	cout << "Error for each iteration..." << endl;
 	cout << all_rms << endl;
 	cout << "Each iterations output..." << endl;
 	cout << all_x << std::endl;
+	cout << "Post-fit residuals..." << endl;
+	cout << postfit_res << endl;
+	cout << "Weighted rms: " << od.get_weighted_rms() << endl;
+	cout << "Leverage..." << endl;
+	cout << od.get_leverage() << endl;
+	cout << "Covariance..." << endl;
+	cout << covariance << endl;
 	//pause/end
 	double j;
 	cin >> j;
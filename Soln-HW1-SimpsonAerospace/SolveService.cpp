@@ -0,0 +1,321 @@
+/// SolveService.cpp : Long-running fit service for the Newton-Raphson solver
+///inputs: fit jobs, one per line on a stream
+///outputs: one result line per job as it converges, stats on request
+//Copyright <2018> <SIMPSONAEROSPACE>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#include "stdafx.h"
+#include "SolveService.h"
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+///Setup
+solve_service::solve_service(newton_raphson<double>::FunctionXp fun, newton_raphson<double>::DerivXp der, int n_state, int n_station, std::ostream& out, int num_threads, int batch_size, int queue_capacity, double stats_interval)
+	: fcn(fun), drv(der), n(n_state), k(n_station), output(out), batch(std::max(1, batch_size)), capacity(std::max(1, queue_capacity)), threads(std::max(1, num_threads)), stopping(false), interval(stats_interval),
+	completed(0), rejected(0), failed(0), total_latency(0.0), max_latency(0.0), started(false), window_completed(0) {
+	for (int i = 0; i < threads; i++)
+	{
+		workers.push_back(std::thread(&solve_service::worker, this));
+	}
+	if (interval > 0.0) {
+		reporter = std::thread(&solve_service::report, this);
+	}
+}
+solve_service::~solve_service() {
+	shutdown();
+}
+
+//////////////////////////////////////////////////////////////
+///Requests
+
+void solve_service::serve(std::istream& in) {
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream tokens(line);
+		std::string command;
+		if (!(tokens >> command)) {
+			continue;
+		}
+		if (command == "fit") {
+			job j;
+			std::string message;
+			if (parse_job(tokens, j, message)) {
+				submit(std::move(j));
+			}
+			else {
+				{
+					std::lock_guard<std::mutex> lock(stats_mutex);
+					rejected++;
+				}
+				write_line("error " + (j.id.empty() ? std::string("-") : j.id) + " " + message);
+			}
+		}
+		else if (command == "stats") {
+			print_stats();
+		}
+		else if (command == "quit") {
+			break;
+		}
+		else {
+			write_line("error - unknown command " + command);
+		}
+	}
+	shutdown();
+}
+
+bool solve_service::parse_job(std::istream& line, job& j, std::string& message) {
+	if (!(line >> j.id)) {
+		message = "missing id";
+		return false;
+	}
+	j.tol = 1.0e-6;
+	j.steps = 100;
+	std::string key;
+	int size;
+	while (line >> key) {
+		if (key == "x0" || key == "xs") {
+			Eigen::VectorXd& v = (key == "x0") ? j.x0 : j.xs;
+			if (!(line >> size) || size < 0) {
+				message = "bad " + key;
+				return false;
+			}
+			//sizes are fixed by the model, check before allocating
+			if (size != ((key == "x0") ? n : k)) {
+				message = key + " must have " + std::to_string((key == "x0") ? n : k) + " states";
+				return false;
+			}
+			v.resize(size);
+			for (int i = 0; i < size; i++)
+			{
+				line >> v(i);
+			}
+		}
+		else if (key == "tol") {
+			line >> j.tol;
+		}
+		else if (key == "steps") {
+			line >> j.steps;
+			if (!line.fail() && (j.steps < 1 || j.steps > max_steps)) {
+				message = "steps must be in 1.." + std::to_string(max_steps);
+				return false;
+			}
+		}
+		else if (key == "obs") {
+			if (!(line >> size) || size < 0) {
+				message = "bad obs";
+				return false;
+			}
+			if (size > max_obs) {
+				message = "at most " + std::to_string(max_obs) + " observations";
+				return false;
+			}
+			j.t.resize(size);
+			j.rho.resize(size);
+			for (int i = 0; i < size; i++)
+			{
+				line >> j.t(i) >> j.rho(i);
+			}
+		}
+		else {
+			message = "unknown field " + key;
+			return false;
+		}
+		if (line.fail()) {
+			message = "bad " + key;
+			return false;
+		}
+	}
+	if (j.x0.rows() != n) {
+		message = "x0 must have " + std::to_string(n) + " states";
+		return false;
+	}
+	if (j.xs.rows() != k) {
+		message = "xs must have " + std::to_string(k) + " states";
+		return false;
+	}
+	if (j.t.rows() < n) {
+		message = "need at least " + std::to_string(n) + " observations";
+		return false;
+	}
+	return true;
+}
+
+void solve_service::submit(job j) {
+	std::unique_lock<std::mutex> lock(queue_mutex);
+	//backpressure
+	not_full.wait(lock, [this] { return stopping || int(queue.size()) < capacity; });
+	j.queued = clock::now();
+	{
+		std::lock_guard<std::mutex> stats_lock(stats_mutex);
+		if (!started) {
+			window_start = j.queued;
+			started = true;
+		}
+	}
+	queue.push_back(std::move(j));
+	not_empty.notify_one();
+}
+
+void solve_service::shutdown() {
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		if (stopping) {
+			return;
+		}
+		stopping = true;
+	}
+	not_empty.notify_all();
+	not_full.notify_all();
+	stop_requested.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+	if (reporter.joinable()) {
+		reporter.join();
+	}
+}
+
+//////////////////////////////////////////////////////////////
+///Output
+
+void solve_service::write_line(const std::string& line) {
+	std::lock_guard<std::mutex> lock(output_mutex);
+	output << line << '\n';
+	output.flush();
+}
+
+void solve_service::print_stats() {
+	std::ostringstream line;
+	size_t queued;
+	{
+		std::lock_guard<std::mutex> queue_lock(queue_mutex);
+		queued = queue.size();
+	}
+	{
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		clock::time_point now = clock::now();
+		double elapsed = started ? std::chrono::duration<double>(now - window_start).count() : 0.0;
+		line << "stats completed " << completed
+			<< " rejected " << rejected
+			<< " failed " << failed
+			<< " queued " << queued
+			<< " mean_latency_us " << (completed > 0 ? total_latency / completed : 0.0)
+			<< " max_latency_us " << max_latency
+			<< " jobs_per_sec " << (elapsed > 0.0 ? (completed - window_completed) / elapsed : 0.0);
+		if (started) {
+			window_completed = completed;
+			window_start = now;
+		}
+	}
+	write_line(line.str());
+}
+
+void solve_service::report() {
+	std::chrono::duration<double> period(interval);
+	std::unique_lock<std::mutex> lock(queue_mutex);
+	while (!stop_requested.wait_for(lock, period, [this] { return stopping; })) {
+		lock.unlock();
+		print_stats();
+		lock.lock();
+	}
+}
+
+//////////////////////////////////////////////////////////////
+///Calculations
+
+void solve_service::worker() {
+	//solver and scratch memory stay warm for the life of the thread
+	solver_workspace<double> workspace;
+	newton_raphson<double> od;
+	od.set_function(&fcn);
+	od.set_deriv(&drv);
+	od.set_workspace(&workspace);
+	std::vector<job> jobs;
+	jobs.reserve(batch);
+
+	while (true) {
+		//take a batch of queued jobs under one lock
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			not_empty.wait(lock, [this] { return stopping || !queue.empty(); });
+			if (queue.empty()) {
+				return;
+			}
+			//a fair share of the queue so idle workers are not starved
+			int take = std::min(batch, std::max(1, int(queue.size()) / threads));
+			while (!queue.empty() && int(jobs.size()) < take) {
+				jobs.push_back(std::move(queue.front()));
+				queue.pop_front();
+			}
+		}
+		not_full.notify_all();
+
+		for (size_t k = 0; k < jobs.size(); k++)
+		{
+			job& j = jobs[k];
+			Eigen::VectorXd rms;
+			Eigen::VectorXd x0_final;
+			bool full_rank;
+			//a failed job is reported, it must not take the worker down
+			try {
+				od.set_x0(j.x0);
+				od.set_ground_station(j.xs);
+				od.set_t(j.t);
+				od.set_actual_range(j.rho);
+				od.set_max_error(j.tol);
+				od.set_num_steps(j.steps);
+				full_rank = od.iterate();
+				rms = od.get_rms();
+				x0_final = od.get_x0();
+			}
+			catch (const std::exception& e) {
+				{
+					std::lock_guard<std::mutex> lock(stats_mutex);
+					failed++;
+				}
+				write_line("error " + j.id + " solve failed: " + e.what());
+				continue;
+			}
+			double final_rms = rms(rms.rows() - 1);
+			//singular only if the first linearization is rank deficient;
+			//losing rank later, a non-finite state or steps that grow
+			//rather than shrink mean the iteration ran away
+			const char* status;
+			if (!full_rank && rms.rows() == 1 && std::isnan(final_rms)) {
+				status = "singular";
+			}
+			else if (!full_rank || !x0_final.allFinite() || !std::isfinite(final_rms) || (final_rms > j.tol && final_rms > rms(0))) {
+				status = "diverged";
+			}
+			else {
+				status = (final_rms <= j.tol) ? "converged" : "max_steps";
+			}
+
+			clock::time_point done = clock::now();
+			double latency = std::chrono::duration<double, std::micro>(done - j.queued).count();
+			{
+				std::lock_guard<std::mutex> lock(stats_mutex);
+				completed++;
+				total_latency += latency;
+				max_latency = std::max(max_latency, latency);
+			}
+
+			std::ostringstream line;
+			line.precision(12);
+			line << "result " << j.id << " " << status << " " << rms.rows() << " " << final_rms << " " << latency;
+			for (int i = 0; i < x0_final.rows(); i++)
+			{
+				line << " " << x0_final(i);
+			}
+			write_line(line.str());
+		}
+		jobs.clear();
+	}
+}
@@ -0,0 +1,128 @@
+/// SolveService.h : Long-running fit service for the Newton-Raphson solver
+///inputs: fit jobs, one per line on a stream
+///outputs: one result line per job as it converges, stats on request
+//Copyright <2018> <SIMPSONAEROSPACE>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "stdafx.h"
+#include "NewtonRaphson.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <Eigen/Dense>
+
+
+#ifndef SOLVESERVICE_H
+#define SOLVESERVICE_H
+
+//protocol (one line each, whitespace separated):
+// fit <id> x0 <n> <x0...> xs <k> <xs...> tol <err> steps <n> obs <m> <t rho>...
+// stats
+// quit
+//replies:
+// result <id> <converged|max_steps|diverged|singular> <iterations> <rms> <latency_us> <x0...>
+// error <id> <message>
+// stats completed <n> rejected <n> failed <n> queued <n> mean_latency_us <t> max_latency_us <t> jobs_per_sec <r>
+//jobs_per_sec covers the time since the previous stats line.
+
+//NOTES:
+//Fit lines are rejected with an error reply if a field is out of range
+//(x0 and xs must match the model, at most max_obs observations and
+//max_steps iterations). A job that throws while solving gets an error
+//reply and counts as failed; the worker carries on. A fit whose first
+//linearization is rank deficient (e.g. too few distinct times) is
+//reported as singular with the initial guess. A fit whose state or rms
+//is not finite, whose last step is larger than its first, or that loses
+//rank after the first step is reported as diverged.
+//Workers pull their share of the queue (queued / threads, at least one,
+//at most batch_size) at a time and keep their own
+//solver and workspace warm between jobs. Submitting blocks while the
+//queue is full, so a fast client is throttled by the solve rate.
+//A stats command is answered in input order and waits behind a blocked
+//fit line; with stats_interval > 0 a reporter thread also writes a stats
+//line every stats_interval seconds, independent of the input.
+
+class solve_service {
+	public:
+		typedef std::chrono::steady_clock clock;
+		//largest request accepted
+		static const int max_obs = 1000000;
+		static const int max_steps = 10000;
+
+		//fit request
+		struct job {
+			std::string id;
+			Eigen::VectorXd x0;
+			Eigen::VectorXd xs;
+			Eigen::VectorXd t;
+			Eigen::VectorXd rho;
+			double tol;
+			int steps;
+			clock::time_point queued;
+		};
+
+		solve_service(newton_raphson<double>::FunctionXp fun, newton_raphson<double>::DerivXp der, int n_state, int n_station, std::ostream& out, int num_threads, int batch_size, int queue_capacity, double stats_interval = 0.0);
+		~solve_service();
+
+		//read requests until quit or end of stream, then drain
+		void serve(std::istream& in);
+		//queue a job, blocking while the queue is full
+		void submit(job j);
+		//write current stats line and start a new rate window
+		void print_stats();
+		//finish queued jobs and stop workers
+		void shutdown();
+
+	private:
+		//model
+		newton_raphson<double>::FunctionXp fcn;
+		newton_raphson<double>::DerivXp drv;
+		int n;
+		int k;
+		//output stream shared by all workers
+		std::ostream& output;
+		std::mutex output_mutex;
+		//bounded job queue
+		std::deque<job> queue;
+		std::mutex queue_mutex;
+		std::condition_variable not_empty;
+		std::condition_variable not_full;
+		int batch;
+		int capacity;
+		int threads;
+		bool stopping;
+		std::vector<std::thread> workers;
+		//periodic stats
+		double interval;
+		std::condition_variable stop_requested;
+		std::thread reporter;
+		//stats
+		std::mutex stats_mutex;
+		long completed;
+		long rejected;
+		long failed;
+		double total_latency;
+		double max_latency;
+		bool started;
+		long window_completed;
+		clock::time_point window_start;
+
+		//parse one fit line, false with a message if malformed
+		bool parse_job(std::istream& line, job& j, std::string& message);
+		void worker();
+		void report();
+		void write_line(const std::string& line);
+
+};
+
+#endif /*SOLVESERVICE_H*/
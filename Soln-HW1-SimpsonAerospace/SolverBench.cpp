@@ -0,0 +1,218 @@
+/// SolverBench.cpp : Repeated-solve benchmark with heap allocation counts
+///inputs: none (synthetic arcs from RangeModel.h)
+///outputs: time and heap allocations per solve for each case, nonzero
+///exit status if a well-posed case is reported rank deficient
+//Copyright <2018> <SIMPSONAEROSPACE>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+//NOTES:
+//Stand-alone program with its own main(), excluded from the application
+//build. Build as a single translation unit, e.g.
+// g++ -std=c++14 -O2 -I<eigen> SolverBench.cpp -o solver_bench
+//Eigen allocates through std::malloc, not operator new, so Eigen heap
+//use is counted with EIGEN_RUNTIME_NO_MALLOC: while malloc is disallowed
+//every Eigen allocation reports through eigen_assert, which is routed to
+//a counter instead of aborting. operator new is counted separately.
+
+#include "stdafx.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+//Eigen allocation counter
+static long eigen_allocs = 0;
+static void eigen_assert_hook(const char* condition, const char* file, int line) {
+	if (std::strstr(condition, "heap allocation") != nullptr) {
+		eigen_allocs++;
+		return;
+	}
+	std::fprintf(stderr, "%s:%d: eigen_assert(%s) failed\n", file, line, condition);
+	std::abort();
+}
+#define EIGEN_RUNTIME_NO_MALLOC
+#define eigen_assert(x) do { if (!(x)) eigen_assert_hook(#x, __FILE__, __LINE__); } while (false)
+
+#include "NewtonRaphson.h"
+#include "SolverWorkspace.h"
+#include "RangeModel.h"
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <Eigen/Dense>
+
+//operator new counter, only while counting. Every form is replaced so
+//new and delete always pair through malloc/free. GCC inlines these
+//bodies into library code and then reports free() on a pointer from
+//operator new (-Wmismatched-new-delete); that pairing is the point of
+//the replacement, so the warning is silenced here only.
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+static bool counting = false;
+static long new_allocs = 0;
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	if (counting) {
+		new_allocs++;
+	}
+	return std::malloc(size ? size : 1);
+}
+void* operator new(std::size_t size) {
+	void* p = operator new(size, std::nothrow);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+void* operator new[](std::size_t size) {
+	return operator new(size);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	return operator new(size, std::nothrow);
+}
+void operator delete(void* p) noexcept {
+	std::free(p);
+}
+void operator delete(void* p, std::size_t) noexcept {
+	std::free(p);
+}
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+	std::free(p);
+}
+void operator delete[](void* p) noexcept {
+	std::free(p);
+}
+void operator delete[](void* p, std::size_t) noexcept {
+	std::free(p);
+}
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+	std::free(p);
+}
+#if defined(__GNUC__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+using namespace std;
+
+//one arc of observations
+struct arc {
+	Eigen::VectorXd t;
+	Eigen::VectorXd rho;
+	Eigen::VectorXd sigma;
+};
+
+//arc of m samples at unit spacing with small range noise
+arc make_arc(const Eigen::VectorXd& truth, const Eigen::VectorXd& xs, int m, mt19937_64& gen) {
+	normal_distribution<double> noise(0.0, 1.0e-3);
+	arc a;
+	a.t.resize(m);
+	a.rho.resize(m);
+	a.sigma = Eigen::VectorXd::Constant(m, 1.0e-3);
+	for (int i = 0; i < m; i++)
+	{
+		a.t(i) = i;
+		a.rho(i) = range_eqn(truth, xs, a.t(i)) + noise(gen);
+	}
+	return a;
+}
+
+//solve arcs round robin, report time and allocations per solve,
+//return the number of rank deficient solves
+int run(const char* name, const vector<arc>& arcs, int solves, newton_raphson<double>::estimator robust) {
+	newton_raphson<double>::FunctionXp fun = bind(&x2rho, placeholders::_1, placeholders::_2, placeholders::_3, placeholders::_4, placeholders::_5);
+	newton_raphson<double>::DerivXp der = bind(&deriv_of_x2rho, placeholders::_1, placeholders::_2, placeholders::_3, placeholders::_4);
+	Eigen::VectorXd x0(5);
+	x0 << 1.5, 10.0, 2.2, 0.5, 0.3;
+	Eigen::VectorXd xs(4);
+	xs << 1.0, 1.0, 0.0, 0.0;
+
+	solver_workspace<double> workspace;
+	newton_raphson<double> od;
+	od.set_workspace(&workspace);
+	od.set_function(&fun);
+	od.set_deriv(&der);
+	od.set_max_error(1.0e-6);
+	od.set_num_steps(50);
+	od.set_ground_station(xs);
+	if (robust != newton_raphson<double>::least_squares) {
+		od.set_robust(robust, 4.685);
+	}
+	//warm up on every arc so buffers reach their largest size
+	for (size_t k = 0; k < arcs.size(); k++)
+	{
+		od.set_t(arcs[k].t);
+		od.set_actual_range(arcs[k].rho);
+		od.set_sigma(arcs[k].sigma);
+		od.set_x0(x0);
+		od.iterate();
+	}
+
+	eigen_allocs = 0;
+	new_allocs = 0;
+	int rank_deficient = 0;
+	counting = true;
+	Eigen::internal::set_is_malloc_allowed(false);
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int k = 0; k < solves; k++)
+	{
+		const arc& a = arcs[k % arcs.size()];
+		od.set_t(a.t);
+		od.set_actual_range(a.rho);
+		od.set_sigma(a.sigma);
+		od.set_x0(x0);
+		if (!od.iterate()) {
+			rank_deficient++;
+		}
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	Eigen::internal::set_is_malloc_allowed(true);
+	counting = false;
+
+	cout << name
+		<< " solves " << solves
+		<< " us_per_solve " << 1.0e6 * seconds / solves
+		<< " eigen_allocs " << eigen_allocs
+		<< " new_allocs " << new_allocs
+		<< " rank_deficient " << rank_deficient << endl;
+	return rank_deficient;
+}
+
+int main()
+{
+	mt19937_64 gen(1);
+	Eigen::VectorXd truth(5);
+	truth << 1.0, 8.0, 2.0, 1.0, 0.5;
+	Eigen::VectorXd xs(4);
+	xs << 1.0, 1.0, 0.0, 0.0;
+	const int solves = 20000;
+	int rank_deficient = 0;
+
+	//same n_obs every solve
+	vector<arc> fixed(1, make_arc(truth, xs, 30, gen));
+	rank_deficient += run("fixed_obs", fixed, solves, newton_raphson<double>::least_squares);
+	//alternating and gapped arc lengths
+	vector<arc> alternating;
+	alternating.push_back(make_arc(truth, xs, 30, gen));
+	alternating.push_back(make_arc(truth, xs, 29, gen));
+	rank_deficient += run("alternating_obs", alternating, solves, newton_raphson<double>::least_squares);
+	vector<arc> varying;
+	uniform_int_distribution<int> length(20, 40);
+	for (int k = 0; k < 64; k++)
+	{
+		varying.push_back(make_arc(truth, xs, length(gen), gen));
+	}
+	rank_deficient += run("varying_obs", varying, solves, newton_raphson<double>::least_squares);
+	rank_deficient += run("varying_obs_tukey", varying, solves, newton_raphson<double>::tukey);
+	//long arc, H'H pivots span ~1e13 but the problem is well posed
+	vector<arc> long_arc(1, make_arc(truth, xs, 1000, gen));
+	rank_deficient += run("long_arc", long_arc, solves / 20, newton_raphson<double>::least_squares);
+
+	return (rank_deficient > 0) ? 1 : 0;
+}
@@ -0,0 +1,143 @@
+/// SolverWorkspace.h : Scratch memory for the Newton-Raphson solver
+///inputs: n_state-states, n_obs-observations, num_steps-max iterations
+///outputs: preallocated buffers reused between problems
+//Copyright <2018> <SIMPSONAEROSPACE>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "stdafx.h"
+#include <algorithm>
+#include <Eigen/Dense>
+
+
+#ifndef SOLVERWORKSPACE_H
+#define SOLVERWORKSPACE_H
+
+//NOTES:
+//Keep one workspace per thread and hand it to every solve on that
+//thread. Observation and step buffers only grow and the solver works on
+//their leading rows, so repeated solves never touch the heap once the
+//largest problem has been seen. Changing the state size reallocates.
+//Iteration history, weights and statistics a solver returns are read
+//from here and are overwritten by the next solve on the workspace; only
+//the final state (get_x0) belongs to the solver.
+
+template <class Bs>
+class solver_workspace {
+	public:
+		//typedef
+		typedef Eigen::Matrix<Bs, Eigen::Dynamic, 1> VectorXp;
+		typedef Eigen::Matrix<Bs, Eigen::Dynamic, Eigen::Dynamic> MatrixXp;
+
+		solver_workspace();
+		solver_workspace(int n_state, int n_obs, int num_steps);
+
+		//size buffers for a problem, growing them only if it needs more
+		//room than any previous one
+		void reserve(int n_state, int n_obs, int num_steps);
+		//start a new problem without freeing
+		void reset();
+
+		//access
+		int state_size();
+		int obs_size();
+		int capacity();
+
+		//iteration history (leading columns) and per-observation
+		//buffers (leading obs_size() rows)
+		MatrixXp x_new;
+		MatrixXp res;
+		VectorXp rms;
+		//normal equations
+		MatrixXp jacobian;
+		MatrixXp weighted_jacobian;
+		VectorXp prefit;
+		VectorXp rhs;
+		VectorXp step;
+		MatrixXp normal;
+		Eigen::LDLT<MatrixXp> normal_matrix;
+		//rank test on the unit-diagonal (equilibrated) normal matrix
+		VectorXp equilibration;
+		MatrixXp scaled_normal;
+		Eigen::LDLT<MatrixXp> scaled_matrix;
+		//robust weights and reweighting scratch
+		VectorXp weight;
+		VectorXp fit_res;
+		VectorXp abs_res;
+
+	private:
+		int n;
+		int m;
+		int max_obs;
+		int max_steps;
+
+};
+
+template <class Bs>
+solver_workspace<Bs>::solver_workspace() : n(0), m(0), max_obs(0), max_steps(0) {
+}
+template <class Bs>
+solver_workspace<Bs>::solver_workspace(int n_state, int n_obs, int num_steps) : n(0), m(0), max_obs(0), max_steps(0) {
+	reserve(n_state, n_obs, num_steps);
+}
+
+template <class Bs>
+void solver_workspace<Bs>::reserve(int n_state, int n_obs, int num_steps) {
+	//at least one column for the initial pass
+	if (num_steps < 1) {
+		num_steps = 1;
+	}
+	bool new_state = (n_state != n);
+	bool grow_obs = new_state || n_obs > max_obs;
+	bool grow_steps = new_state || num_steps > max_steps;
+	n = n_state;
+	m = n_obs;
+	max_obs = std::max(max_obs, n_obs);
+	max_steps = std::max(max_steps, num_steps);
+	if (grow_steps) {
+		x_new.resize(n, max_steps);
+		res.resize(n, max_steps);
+		rms.resize(max_steps);
+	}
+	if (new_state) {
+		rhs.resize(n);
+		step.resize(n);
+		normal.resize(n, n);
+		normal_matrix = Eigen::LDLT<MatrixXp>(n);
+		equilibration.resize(n);
+		scaled_normal.resize(n, n);
+		scaled_matrix = Eigen::LDLT<MatrixXp>(n);
+	}
+	if (grow_obs) {
+		jacobian.resize(max_obs, n);
+		weighted_jacobian.resize(max_obs, n);
+		prefit.resize(max_obs);
+		weight.resize(max_obs);
+		fit_res.resize(max_obs);
+		abs_res.resize(max_obs);
+	}
+}
+template <class Bs>
+void solver_workspace<Bs>::reset() {
+	weight.head(m).setOnes();
+}
+
+//access
+template <class Bs>
+int solver_workspace<Bs>::state_size() {
+	return n;
+}
+template <class Bs>
+int solver_workspace<Bs>::obs_size() {
+	return m;
+}
+template <class Bs>
+int solver_workspace<Bs>::capacity() {
+	return max_steps;
+}
+
+#endif /*SOLVERWORKSPACE_H*/
@@ -0,0 +1,266 @@
+/// TrackingGenerator.cpp : Synthetic range tracking data for load tests
+///inputs: range model, objects, stations, arc length, noise, gaps, outliers
+///outputs: fit jobs in the solve service format, one arc per line
+//Copyright <2018> <SIMPSONAEROSPACE>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#include "stdafx.h"
+#include "TrackingGenerator.h"
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+
+//stream domains
+static const unsigned long long object_stream = 0x6f626a6563740000ULL;
+static const unsigned long long station_stream = 0x73746174696f6e00ULL;
+static const unsigned long long arc_stream = 0x6172630000000000ULL;
+
+//append " <value>" to a text buffer, fixed to 1e-9 with trailing zeros
+//trimmed; snprintf only for magnitudes the integer path cannot carry
+static void append(std::string& buffer, double value) {
+	char text[40];
+	double magnitude = std::fabs(value);
+	if (!(magnitude < 1.0e9) || (magnitude < 1.0e-3 && value != 0.0)) {
+		int length = snprintf(text, sizeof(text), " %.12g", value);
+		buffer.append(text, length);
+		return;
+	}
+	long long scaled = std::llround(magnitude * 1.0e9);
+	long long whole = scaled / 1000000000;
+	long long frac = scaled % 1000000000;
+	//digits are written backwards from the end of text
+	char* end = text + sizeof(text);
+	char* p = end;
+	int digits = 9;
+	while (digits > 0 && frac % 10 == 0) {
+		frac /= 10;
+		digits--;
+	}
+	if (digits > 0) {
+		for (int i = 0; i < digits; i++)
+		{
+			*--p = char('0' + frac % 10);
+			frac /= 10;
+		}
+		*--p = '.';
+	}
+	do {
+		*--p = char('0' + whole % 10);
+		whole /= 10;
+	} while (whole > 0);
+	if (value < 0.0 && scaled != 0) {
+		*--p = '-';
+	}
+	*--p = ' ';
+	buffer.append(p, end - p);
+}
+static void append(std::string& buffer, const Eigen::VectorXd& values) {
+	append(buffer, double(values.rows()));
+	for (int i = 0; i < values.rows(); i++)
+	{
+		append(buffer, values(i));
+	}
+}
+
+///Setup
+tracking_generator::tracking_generator(RangeModel model, const config& settings) : rho(model), cfg(settings), dropped(0) {
+	//missing spreads and guess errors are zero
+	int n = int(cfg.x0_mean.rows());
+	int k = int(cfg.xs_mean.rows());
+	if (cfg.x0_spread.rows() != n) {
+		cfg.x0_spread.setZero(n);
+	}
+	if (cfg.guess_sigma.rows() != n) {
+		cfg.guess_sigma.setZero(n);
+	}
+	if (cfg.xs_spread.rows() != k) {
+		cfg.xs_spread.setZero(k);
+	}
+	cfg.threads = std::max(1, cfg.threads);
+	cfg.arcs_per_block = std::max(1, cfg.arcs_per_block);
+	cfg.gap_length = std::max(1, cfg.gap_length);
+
+	//stations are shared by every object
+	std::uniform_real_distribution<double> spread(-1.0, 1.0);
+	stations.resize(k, cfg.stations);
+	for (int s = 0; s < cfg.stations; s++)
+	{
+		std::mt19937_64 gen = stream(cfg.seed ^ station_stream, s);
+		for (int i = 0; i < k; i++)
+		{
+			stations(i, s) = cfg.xs_mean(i) + cfg.xs_spread(i) * spread(gen);
+		}
+	}
+}
+
+std::mt19937_64 tracking_generator::stream(unsigned long long seed, unsigned long long index) {
+	//splitmix64 so neighbouring indices give unrelated streams
+	unsigned long long z = seed + 0x9e3779b97f4a7c15ULL * (index + 1);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return std::mt19937_64(z ^ (z >> 31));
+}
+
+//access
+long long tracking_generator::get_dropped() {
+	return dropped;
+}
+
+//////////////////////////////////////////////////////////////
+///Calculations
+
+long long tracking_generator::write_block(long long first, long long last, std::string& buffer, long long& short_arcs) {
+	std::uniform_real_distribution<double> spread(-1.0, 1.0);
+	std::uniform_real_distribution<double> chance(0.0, 1.0);
+	std::normal_distribution<double> normal(0.0, 1.0);
+	int n = int(cfg.x0_mean.rows());
+	Eigen::VectorXd truth(n);
+	Eigen::VectorXd guess(n);
+	Eigen::VectorXd xs;
+	std::string obs;
+	long long written = 0;
+
+	for (long long arc = first; arc < last; arc++)
+	{
+		long long object = arc / cfg.stations;
+		int station = int(arc % cfg.stations);
+		//truth depends only on the object
+		std::mt19937_64 object_gen = stream(cfg.seed ^ object_stream, object);
+		for (int i = 0; i < n; i++)
+		{
+			truth(i) = cfg.x0_mean(i) + cfg.x0_spread(i) * spread(object_gen);
+		}
+		xs = stations.col(station);
+
+		std::mt19937_64 gen = stream(cfg.seed ^ arc_stream, arc);
+		for (int i = 0; i < n; i++)
+		{
+			guess(i) = truth(i) + cfg.guess_sigma(i) * normal(gen);
+		}
+
+		//samples with gaps, noise and outliers
+		obs.clear();
+		int m = 0;
+		int gap = 0;
+		for (int j = 0; j < cfg.samples; j++)
+		{
+			if (gap > 0) {
+				gap--;
+				continue;
+			}
+			if (cfg.gap_probability > 0.0 && chance(gen) < cfg.gap_probability) {
+				gap = cfg.gap_length - 1;
+				continue;
+			}
+			double t = cfg.t0 + cfg.dt * j;
+			double range = rho(truth, xs, t);
+			if (cfg.noise > 0.0) {
+				range += cfg.noise * normal(gen);
+			}
+			if (cfg.outlier_probability > 0.0 && chance(gen) < cfg.outlier_probability) {
+				range += cfg.outlier_sigma * normal(gen);
+			}
+			append(obs, t);
+			append(obs, range);
+			m++;
+		}
+		if (m < n) {
+			short_arcs++;
+			continue;
+		}
+
+		buffer += "fit ";
+		buffer += std::to_string(object) + "." + std::to_string(station);
+		buffer += " x0";
+		append(buffer, guess);
+		buffer += " xs";
+		append(buffer, xs);
+		buffer += " tol";
+		append(buffer, cfg.tol);
+		buffer += " steps " + std::to_string(cfg.steps);
+		buffer += " obs " + std::to_string(m);
+		buffer += obs;
+		buffer += '\n';
+		written += m;
+	}
+	return written;
+}
+
+long long tracking_generator::generate(std::ostream& out) {
+	long long arcs = (long long)cfg.objects * cfg.stations;
+	long long per_block = cfg.arcs_per_block;
+	long long blocks = (arcs + per_block - 1) / per_block;
+	//blocks finish out of order, a bounded window keeps them for the writer
+	int window = 2 * cfg.threads;
+	std::vector<std::string> slot(window);
+	std::vector<long long> slot_block(window, -1);
+	std::mutex m;
+	std::condition_variable cv;
+	long long next = 0;
+	long long written = 0;
+	long long samples = 0;
+	dropped = 0;
+
+	auto work = [&]() {
+		std::string buffer;
+		while (true) {
+			long long b;
+			{
+				std::unique_lock<std::mutex> lock(m);
+				if (next >= blocks) {
+					return;
+				}
+				b = next++;
+				cv.wait(lock, [&] { return b < written + window; });
+			}
+			long long short_arcs = 0;
+			buffer.clear();
+			long long count = write_block(b * per_block, std::min(arcs, (b + 1) * per_block), buffer, short_arcs);
+			{
+				std::lock_guard<std::mutex> lock(m);
+				slot[b % window].swap(buffer);
+				slot_block[b % window] = b;
+				samples += count;
+				dropped += short_arcs;
+			}
+			cv.notify_all();
+		}
+	};
+	std::vector<std::thread> workers;
+	for (int i = 0; i < cfg.threads; i++)
+	{
+		workers.push_back(std::thread(work));
+	}
+
+	//write blocks in arc order
+	std::string ready;
+	while (written < blocks) {
+		{
+			std::unique_lock<std::mutex> lock(m);
+			cv.wait(lock, [&] { return slot_block[written % window] == written; });
+			ready.swap(slot[written % window]);
+			slot_block[written % window] = -1;
+		}
+		out.write(ready.data(), ready.size());
+		ready.clear();
+		{
+			std::lock_guard<std::mutex> lock(m);
+			written++;
+		}
+		cv.notify_all();
+	}
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		workers[i].join();
+	}
+	out.flush();
+	return samples;
+}
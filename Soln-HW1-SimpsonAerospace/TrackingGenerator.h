@@ -0,0 +1,87 @@
+/// TrackingGenerator.h : Synthetic range tracking data for load tests
+///inputs: range model, objects, stations, arc length, noise, gaps, outliers
+///outputs: fit jobs in the solve service format, one arc per line
+//Copyright <2018> <SIMPSONAEROSPACE>
+//
+//Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions :
+//
+//The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+//
+//THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+#include "stdafx.h"
+#include <iostream>
+#include <string>
+#include <functional>
+#include <random>
+#include <Eigen/Dense>
+
+
+#ifndef TRACKINGGENERATOR_H
+#define TRACKINGGENERATOR_H
+
+//NOTES:
+//Every object/station pair is one arc and one fit line. Each arc draws
+//from its own generator seeded by (seed, arc), so the output is the same
+//for any number of threads. Arcs left with fewer samples than states
+//after gaps are dropped. An arc is written as one fit line, so samples
+//must not exceed the solve service's max_obs or the service rejects it.
+
+class tracking_generator {
+	public:
+		//rho(x0, xs, t)
+		typedef std::function <double(const Eigen::VectorXd&, const Eigen::VectorXd&, double)> RangeModel;
+
+		struct config {
+			//problem size
+			int objects = 1;
+			int stations = 1;
+			int samples = 5;
+			double t0 = 0.0;
+			double dt = 1.0;
+			//true initial states drawn uniformly in mean +/- spread
+			Eigen::VectorXd x0_mean;
+			Eigen::VectorXd x0_spread;
+			//station states drawn uniformly in mean +/- spread
+			Eigen::VectorXd xs_mean;
+			Eigen::VectorXd xs_spread;
+			//initial guess error (1-sigma) about the truth
+			Eigen::VectorXd guess_sigma;
+			//range noise (1-sigma)
+			double noise = 0.0;
+			//chance per sample of starting a gap of gap_length samples
+			double gap_probability = 0.0;
+			int gap_length = 1;
+			//chance per sample of an outlier of outlier_sigma (1-sigma)
+			double outlier_probability = 0.0;
+			double outlier_sigma = 0.0;
+			//solver settings written with each job
+			double tol = 1.0e-6;
+			int steps = 100;
+			//reproducibility and parallelism
+			unsigned long long seed = 1;
+			int threads = 1;
+			int arcs_per_block = 64;
+		};
+
+		tracking_generator(RangeModel model, const config& settings);
+
+		//write every arc to out in arc order, return samples written
+		long long generate(std::ostream& out);
+		//arcs dropped for being too short
+		long long get_dropped();
+
+	private:
+		RangeModel rho;
+		config cfg;
+		Eigen::MatrixXd stations;
+		long long dropped;
+
+		//append arcs [first, last) to buffer, return samples written
+		long long write_block(long long first, long long last, std::string& buffer, long long& short_arcs);
+		//independent stream for an arc or station
+		static std::mt19937_64 stream(unsigned long long seed, unsigned long long index);
+
+};
+
+#endif /*TRACKINGGENERATOR_H*/